@@ -0,0 +1,346 @@
+// RS30x ブリッジモード
+// PCから送られたRS30xパケットをサーボへ中継し, サーボの返信をタイムスタンプ付きでPCへ返します.
+// PC側, サーボ側のストリームと時計はBridgePortで渡すので, ESP32以外(PC上のテストなど)でも動かせます.
+//
+// PC → ESP32 : [0xA5][Seq][Len][RS30xパケット (Len byte)][Sum]
+// ESP32 → PC : [0xA5][Seq][Status][送信完了時刻 (4byte)][返信までの時間 (4byte)][Len][返信データ (Len byte)][Sum]
+//   Sum は Seq～データまでのXOR, 時刻はμs単位でいずれもリトルエンディアンです.
+//   Status 0:返信あり 1:返信を求めないパケット 2:返信タイムアウト 3:フレーム異常
+//   Flagsで返信にACKを指定したパケットは, 返信データが0x07(ACK)または0x08(NACK)の1byteになります.
+// 要求はSeqを変えて返信を待たずに続けて送ることができ, 受信した順にサーボへ中継して同じSeqで返信します.
+
+#ifndef RS30X_BRIDGE_H
+#define RS30X_BRIDGE_H
+
+#include <Arduino.h>
+
+#define BRIDGE_SYNC 0xA5           // フレームの先頭
+#define BRIDGE_MAX_PACKET 140      // 中継できるパケットの最大長 (返信も同じ)
+#define BRIDGE_MARGIN_US 500       // 返信待ち時間の余裕 [μs]
+#define BRIDGE_HOST_MARGIN_US 2000 // PCフレームのバイト間待ち時間の余裕 [μs] (USB転送やUARTのFIFOでまとめて届く分)
+#define BRIDGE_MAX_FRAME (BRIDGE_MAX_PACKET + 4) // PCからのフレームの最大長
+
+#define BRIDGE_FEED_NONE 0  // フレーム受信途中
+#define BRIDGE_FEED_FRAME 1 // フレーム受信完了
+#define BRIDGE_FEED_ERROR 2 // フレーム異常
+
+#define BRIDGE_STATUS_OK 0        // 返信あり
+#define BRIDGE_STATUS_NO_REPLY 1  // 返信を求めないパケット
+#define BRIDGE_STATUS_TIMEOUT 2   // 返信タイムアウト
+#define BRIDGE_STATUS_BAD_FRAME 3 // フレーム異常
+
+#define RS30X_ACK 0x07  // ACK
+#define RS30X_NACK 0x08 // NACK
+
+struct BridgeParser
+{
+    unsigned char state; // 0:先頭待ち 1:Seq 2:Len 3:データ 4:Sum
+    unsigned char seq;   // シーケンス番号
+    unsigned char len;   // パケット長
+    unsigned char idx;   // 受信済みのデータ数
+    unsigned char sum;   // チェックサム計算用変数
+    unsigned char data[BRIDGE_MAX_PACKET]; // 中継するRS30xパケット
+    unsigned char raw[BRIDGE_MAX_FRAME];   // 受信したフレームそのまま (異常時の読み直し用)
+    int raw_len;                           // rawのバイト数
+};
+
+struct BridgePort
+{
+    Stream *host;                       // PC側のストリーム
+    Stream *bus;                        // サーボ側のストリーム (受信)
+    unsigned long (*now)();             // μs単位の時計
+    void (*send)(unsigned char *, int); // サーボへのパケット送信 (送受信の切り替えを含む)
+    unsigned long first_byte_us;        // 送信完了から返信の1byte目までの待ち時間 [μs]
+    unsigned long gap_us;               // 返信のバイト間の待ち時間 [μs]
+    unsigned long host_gap_us;          // PCフレームのバイト間の待ち時間 [μs]
+    unsigned long host_last;            // PCから最後に受信した時刻
+    BridgeParser rx;                    // PCからのフレーム受信状態
+    unsigned char replay[BRIDGE_MAX_FRAME]; // 読み直すバイト列 (PCからの受信より先に処理する)
+    int replay_len;                         // replayのバイト数
+    int replay_pos;                         // replayの読み出し位置
+};
+
+///////////////　返 信 待 ち 時 間 の 設 定　///////////////
+// bus_baud はサーボとの通信速度, host_baud はPCとの通信速度, res_delay はサーボの返信ディレイ設定値(0~127)です.
+void Bridge_SetTiming(BridgePort &b, unsigned long bus_baud, unsigned long host_baud, int res_delay)
+{
+    unsigned long byte_us = (10UL * 1000000UL + bus_baud - 1) / bus_baud;       // 1byte (10bit) の転送時間
+    unsigned long host_byte_us = (10UL * 1000000UL + host_baud - 1) / host_baud; // PC側の1byteの転送時間
+
+    b.first_byte_us = 100 + 50 * res_delay + byte_us * 2 + BRIDGE_MARGIN_US;
+    b.gap_us = byte_us * 4 + BRIDGE_MARGIN_US;
+    b.host_gap_us = host_byte_us * 4 + BRIDGE_HOST_MARGIN_US;
+    b.host_last = 0;
+    b.rx.state = 0;
+    b.replay_len = 0;
+    b.replay_pos = 0;
+}
+
+///////////////　ブ リ ッ ジ フ レ ー ム の 受 信　///////////////
+// 1byteずつ渡し, フレームが揃ったらBRIDGE_FEED_FRAMEを返します. (シリアル入出力には触れません)
+int Bridge_Feed(BridgeParser &p, unsigned char c)
+{
+    if (p.state == 0)
+    {
+        p.raw_len = 0;
+    }
+    if (p.state != 0 || c == BRIDGE_SYNC)
+    {
+        p.raw[p.raw_len++] = c;
+    }
+
+    switch (p.state)
+    {
+    case 0: // 先頭待ち
+        if (c == BRIDGE_SYNC)
+        {
+            p.state = 1;
+        }
+        break;
+    case 1: // Seq
+        p.seq = c;
+        p.sum = c;
+        p.state = 2;
+        break;
+    case 2: // Len
+        p.state = 0;
+        if (c == 0 || c > BRIDGE_MAX_PACKET)
+        {
+            return BRIDGE_FEED_ERROR;
+        }
+        p.len = c;
+        p.idx = 0;
+        p.sum ^= c;
+        p.state = 3;
+        break;
+    case 3: // データ
+        p.data[p.idx++] = c;
+        p.sum ^= c;
+        if (p.idx == p.len)
+        {
+            p.state = 4;
+        }
+        break;
+    default: // Sum
+        p.state = 0;
+        return (c == p.sum) ? BRIDGE_FEED_FRAME : BRIDGE_FEED_ERROR;
+    }
+    return BRIDGE_FEED_NONE;
+}
+
+///////////////　ブ リ ッ ジ 返 信 の 送 信　///////////////
+void Bridge_Respond(BridgePort &b, unsigned char seq, unsigned char status, unsigned long t_tx, unsigned long t_reply, unsigned char *reply, int len)
+{
+    unsigned char frame[BRIDGE_MAX_PACKET + 13]; // 送信データバッファ
+    unsigned char sum = 0;                       // チェックサム計算用変数
+
+    frame[0] = BRIDGE_SYNC; // Header
+    frame[1] = seq;         // Seq
+    frame[2] = status;      // Status
+    for (int i = 0; i < 4; i++)
+    {
+        frame[3 + i] = (unsigned char)(t_tx >> (8 * i));    // 送信完了時刻
+        frame[7 + i] = (unsigned char)(t_reply >> (8 * i)); // 返信までの時間
+    }
+    frame[11] = (unsigned char)len; // Len
+    for (int i = 0; i < len; i++)
+    {
+        frame[12 + i] = reply[i]; // 返信データ
+    }
+
+    // チェックサム計算
+    for (int i = 1; i < 12 + len; i++)
+    {
+        sum = sum ^ frame[i]; // Seq～データまでのXOR
+    }
+    frame[12 + len] = sum; // Sum
+
+    b.host->write(frame, 13 + len); // 1回の書き込みでまとめて送信
+}
+
+///////////////　送 信 エ コ ー の 読 み 捨 て　///////////////
+// Meridian Board -LITE- やICS変換基板では送信したパケットが受信側にも返ってくるため, 返信を待つ前に読み捨てます.
+// 送信したパケットと一致するバイトだけを捨てるので, エコーのない構成でもサーボの返信は失われません.
+void Bridge_SkipEcho(BridgePort &b, unsigned char *packet, int len, unsigned long t_tx)
+{
+    unsigned long last = t_tx;
+    int i = 0;
+
+    while (i < len)
+    {
+        if (b.bus->available() > 0)
+        {
+            if (b.bus->peek() != packet[i])
+            {
+                return; // エコーではない
+            }
+            b.bus->read();
+            i++;
+            last = b.now();
+        }
+        else if (b.now() - last > b.gap_us)
+        {
+            return; // エコーなし, または途中で途切れた
+        }
+    }
+}
+
+///////////////　サ ー ボ 返 信 の 受 信　///////////////
+// 返信の長さを返します. タイムアウトの場合は-1.
+// 最初の1byteは送信完了時刻 t_tx から返信ディレイを含めて待ちます.
+int Bridge_Receive(BridgePort &b, unsigned char *reply, bool ack, unsigned long t_tx, unsigned long *t_rx)
+{
+    int n = 0;
+    int need = ack ? 1 : 7;                  // ACKは1byte, リターンパケットはまずHeader～Cntの7byte
+    unsigned long wait_us = b.first_byte_us; // 最初の1byteは返信ディレイを含めて待つ
+    unsigned long last = t_tx;
+
+    while (n < need)
+    {
+        if (b.bus->available() > 0)
+        {
+            unsigned char c = b.bus->read();
+            if (ack && c != RS30X_ACK && c != RS30X_NACK)
+            {
+                continue; // ACK/NACK以外は読み飛ばす
+            }
+            if (!ack && n == 0 && c != 0xFD)
+            {
+                continue; // Header待ち
+            }
+            if (!ack && n == 1 && c != 0xDF)
+            {
+                n = (c == 0xFD) ? 1 : 0; // Headerの取り直し
+                continue;
+            }
+            reply[n++] = c;
+            last = b.now();
+            *t_rx = last;
+            wait_us = b.gap_us; // 以降はバイト間の無通信時間で判定
+            if (!ack && n == 7)
+            {
+                need = 8 + reply[5]; // Header～Cnt + Length分のデータ + Sum
+                if (need > BRIDGE_MAX_PACKET)
+                {
+                    return -1;
+                }
+            }
+        }
+        else if (b.now() - last > wait_us)
+        {
+            return -1; // タイムアウト
+        }
+    }
+    return n;
+}
+
+///////////////　パ ケ ッ ト の 中 継　///////////////
+void Bridge_Transact(BridgePort &b)
+{
+    BridgeParser &p = b.rx;
+    unsigned char reply[BRIDGE_MAX_PACKET]; // 受信データバッファ
+    unsigned long t_rx = 0;                 // 返信受信完了時刻
+
+    // RS30xのパケットとして最低限の形になっているか確認
+    if (p.len < 8 || p.data[0] != 0xFA || p.data[1] != 0xAF)
+    {
+        Bridge_Respond(b, p.seq, BRIDGE_STATUS_BAD_FRAME, b.now(), 0, reply, 0);
+        return;
+    }
+
+    while (b.bus->available() > 0)
+    {
+        b.bus->read(); // 前回の残りを破棄
+    }
+
+    b.send(p.data, p.len); // パケットデータ送信
+    unsigned long t_tx = b.now();
+
+    unsigned char ret = p.data[3] & 0x0F; // Flagsの返信指定
+    if (ret == 0)
+    {
+        Bridge_Respond(b, p.seq, BRIDGE_STATUS_NO_REPLY, t_tx, 0, reply, 0);
+        return;
+    }
+
+    Bridge_SkipEcho(b, p.data, p.len, t_tx);
+    int len = Bridge_Receive(b, reply, ret == 0x01, t_tx, &t_rx); // 0x01はACK/NACKのみの返信
+    if (len < 0)
+    {
+        Bridge_Respond(b, p.seq, BRIDGE_STATUS_TIMEOUT, t_tx, b.now() - t_tx, reply, 0);
+        return;
+    }
+    Bridge_Respond(b, p.seq, BRIDGE_STATUS_OK, t_tx, t_rx - t_tx, reply, len);
+}
+
+///////////////　フ レ ー ム の 読 み 直 し　///////////////
+// 異常となったフレームの先頭(0xA5)の次のバイトから読み直します.
+// 1byte欠けたフレームが続けて届いた次のフレームの先頭を飲み込んでも, 次のフレームを取りこぼさないようにするためです.
+// 読み直し中に異常となった場合も, 先頭の0xA5を捨てる分だけ読み直すバイト列は短くなります.
+void Bridge_Rescan(BridgePort &b)
+{
+    unsigned char buf[BRIDGE_MAX_FRAME];
+    int n = 0;
+
+    for (int i = 1; i < b.rx.raw_len; i++)
+    {
+        buf[n++] = b.rx.raw[i]; // 異常フレームの2byte目以降
+    }
+    for (int i = b.replay_pos; i < b.replay_len; i++)
+    {
+        buf[n++] = b.replay[i]; // 読み直し途中の残り
+    }
+    for (int i = 0; i < n; i++)
+    {
+        b.replay[i] = buf[i];
+    }
+    b.replay_len = n;
+    b.replay_pos = 0;
+    b.rx.state = 0;
+    b.rx.raw_len = 0;
+}
+
+///////////////　ブ リ ッ ジ モ ー ド の 処 理　///////////////
+void Bridge_Poll(BridgePort &b)
+{
+    // フレームの途中でPCからの受信が途切れたら, 欠けたフレームを捨てて読み直す.
+    if (b.rx.state != 0 && b.now() - b.host_last > b.host_gap_us)
+    {
+        if (b.rx.state >= 2)
+        {
+            Bridge_Respond(b, b.rx.seq, BRIDGE_STATUS_BAD_FRAME, b.now(), 0, b.rx.data, 0); // Seqは受信済み
+        }
+        Bridge_Rescan(b);
+    }
+
+    while (true)
+    {
+        unsigned char c;
+        if (b.replay_pos < b.replay_len)
+        {
+            c = b.replay[b.replay_pos++]; // 読み直し分を先に処理
+        }
+        else if (b.host->available() > 0)
+        {
+            c = (unsigned char)b.host->read();
+            b.host_last = b.now();
+        }
+        else
+        {
+            break;
+        }
+
+        int result = Bridge_Feed(b.rx, c);
+        if (result == BRIDGE_FEED_FRAME)
+        {
+            Bridge_Transact(b);
+        }
+        else if (result == BRIDGE_FEED_ERROR)
+        {
+            Bridge_Respond(b, b.rx.seq, BRIDGE_STATUS_BAD_FRAME, b.now(), 0, b.rx.data, 0);
+            Bridge_Rescan(b);
+        }
+    }
+}
+
+#endif
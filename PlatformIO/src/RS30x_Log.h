@@ -0,0 +1,139 @@
+// RS30x ログ出力
+// Serial.printを直接呼ぶとUSBシリアルの送信バッファが満杯の時に処理が止まり, サーボ制御のタイミングが乱れます.
+// そこでログは文字列ポインタと数値だけをリングバッファに積み, 低優先度のタスクが整形してSerialへ送り出します.
+// バッファが満杯の時は記録を捨てて件数を数えるだけなので, 呼び出し側が待たされることはありません.
+// LOG_LEVELより詳細なレベルのログ呼び出しはコンパイル時に削除されます.
+// 記録の追加・整形・送り出しはシリアル入出力から切り離してあり, PC上のテストでも動かせます.
+
+#ifndef RS30X_LOG_H
+#define RS30X_LOG_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <stdio.h>
+
+#define LOG_LEVEL_NONE 0  // ログ出力なし
+#define LOG_LEVEL_INFO 1  // 設定結果などのインフォメーション
+#define LOG_LEVEL_DEBUG 2 // loop()の動作マーカーなど
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(str) Log_Push(str, 0, LOG_T_STR)
+#define LOG_INFO_LN(str) Log_Push(str, 0, LOG_T_STR_LN)
+#define LOG_INFO_VAL(str, val) Log_Push(str, (long)(val), LOG_T_VAL)
+#define LOG_INFO_VAL_LN(str, val) Log_Push(str, (long)(val), LOG_T_VAL_LN)
+#else
+#define LOG_INFO(str) ((void)0)
+#define LOG_INFO_LN(str) ((void)0)
+#define LOG_INFO_VAL(str, val) ((void)0)
+#define LOG_INFO_VAL_LN(str, val) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(str) Log_Push(str, 0, LOG_T_STR)
+#else
+#define LOG_DEBUG(str) ((void)0)
+#endif
+
+#if LOG_LEVEL > LOG_LEVEL_NONE // ログを使わない場合はバッファも確保しない
+
+#define LOG_BUF_SIZE 64   // リングバッファの記録数 (2のべき乗)
+#define LOG_LINE_SIZE 96  // 1記録を整形する際の最大文字数
+
+enum LogType : unsigned char
+{
+    LOG_T_STR,    // 文字列のみ
+    LOG_T_STR_LN, // 文字列 + 改行
+    LOG_T_VAL,    // 文字列 + 数値
+    LOG_T_VAL_LN  // 文字列 + 数値 + 改行
+};
+
+struct LogRecord
+{
+    const char *str; // 文字列リテラルへのポインタ (整形は送信タスクで行う)
+    long val;        // 数値フィールド
+    LogType type;    // 記録の種類
+};
+
+LogRecord LogBuf[LOG_BUF_SIZE];            // ログのリングバッファ
+std::atomic<unsigned int> LogHead(0);      // 書き込み位置 (ログを積むloopタスクのみが更新)
+std::atomic<unsigned int> LogTail(0);      // 読み出し位置 (送信タスクのみが更新)
+std::atomic<unsigned long> LogDropped(0);  // バッファ満杯で捨てた記録数
+
+/////////////////　ロ グ 記 録 の 追 加　/////////////////
+// 文字列はリテラルなどプログラム終了まで有効なものを渡してください.
+void Log_Push(const char *str, long val, LogType type)
+{
+    unsigned int head = LogHead.load(std::memory_order_relaxed);
+    if (head - LogTail.load(std::memory_order_acquire) >= LOG_BUF_SIZE)
+    {
+        LogDropped.fetch_add(1, std::memory_order_relaxed); // 満杯なので捨てる
+        return;
+    }
+    LogRecord &rec = LogBuf[head & (LOG_BUF_SIZE - 1)];
+    rec.str = str;
+    rec.val = val;
+    rec.type = type;
+    LogHead.store(head + 1, std::memory_order_release);
+}
+
+/////////////////　ロ グ 記 録 の 整 形　/////////////////
+int Log_Format(const LogRecord &rec, char *line, int size)
+{
+    const char *nl = (rec.type == LOG_T_STR_LN || rec.type == LOG_T_VAL_LN) ? "\r\n" : "";
+    int len;
+    if (rec.type == LOG_T_VAL || rec.type == LOG_T_VAL_LN)
+    {
+        len = snprintf(line, size, "%s%ld%s", rec.str, rec.val, nl);
+    }
+    else
+    {
+        len = snprintf(line, size, "%s%s", rec.str, nl);
+    }
+    if (len >= size)
+    {
+        len = size - 1; // 長すぎる記録は切り詰める
+    }
+    return len;
+}
+
+/////////////////　ロ グ の 送 り 出 し　/////////////////
+// 出力先(通常はSerial)の送信バッファに空きがある分だけ書き出し, 空きがなければ次回に回します.
+void Log_Drain(Stream &out)
+{
+    char line[LOG_LINE_SIZE];
+
+    while (true)
+    {
+        unsigned int tail = LogTail.load(std::memory_order_relaxed);
+        if (tail == LogHead.load(std::memory_order_acquire))
+        {
+            break; // 送信待ちの記録なし
+        }
+        int len = Log_Format(LogBuf[tail & (LOG_BUF_SIZE - 1)], line, sizeof(line));
+        if (out.availableForWrite() < len)
+        {
+            return; // 送信バッファに空きができるまで待つ
+        }
+        out.write((const uint8_t *)line, len);
+        LogTail.store(tail + 1, std::memory_order_release);
+    }
+
+    unsigned long dropped = LogDropped.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0)
+    {
+        int len = snprintf(line, sizeof(line), "\r\n[log] %lu records dropped.\r\n", dropped);
+        if (out.availableForWrite() < len)
+        {
+            LogDropped.fetch_add(dropped, std::memory_order_relaxed); // 次回に報告
+            return;
+        }
+        out.write((const uint8_t *)line, len);
+    }
+}
+
+#endif // LOG_LEVEL > LOG_LEVEL_NONE
+
+#endif
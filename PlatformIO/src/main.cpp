@@ -63,6 +63,9 @@ int AllReset = 0;
 // [7] 使用環境は？　（0:ESP32DevkitCのみ 1:ESP32+Meridian Board -LITE- or ICS変換基板）
 int Device = 0; // 1 の場合は返信をシリアルモニタで表示します.
 
+// [8] ブリッジモードにしますか？　（0:no 1:yes PCからのRS30xパケットをサーボへ中継. 1の場合は[2]~[6]は実行せず, 通信速度は[1]を使います)
+int USE_BRIDGE = 0;
+
 // ******************************** 設定はここまで ************************************
 
 /* グローバル変数定義 */
@@ -70,6 +73,31 @@ int EN_R_PIN = 4;     // デジタルPin23を送信イネーブルピンに設
 int RS30x_speed = 50; //サーボ速度指定
 int FutabaBaudRates[12] = {9600, 14400, 19200, 28800, 38400, 57600, 76800, 115200, 153600, 230400, 460800, 691200};
 #include <Arduino.h>
+#include "RS30x_Bridge.h"
+#include "RS30x_Log.h"
+
+/////////////////　ロ グ 送 信 タ ス ク　/////////////////
+// ログの記録・整形の本体はRS30x_Log.hにあります.
+#if LOG_LEVEL > LOG_LEVEL_NONE
+void Log_Task(void *pvParameters)
+{
+    for (;;)
+    {
+        Log_Drain(Serial);
+        vTaskDelay(1); // 1tick待機して他のタスクに譲る
+    }
+}
+#endif
+
+/////////////////　ロ グ 出 力 の 開 始　/////////////////
+void Log_Begin()
+{
+#if LOG_LEVEL > LOG_LEVEL_NONE
+    // サーボ制御を行うloop()はコア1で動くため, 送信タスクはコア0の最低優先度で動かす.
+    // snprintfと整形用の行バッファを使うので, スタックは4096byte確保する.
+    xTaskCreatePinnedToCore(Log_Task, "Log_Task", 4096, NULL, tskIDLE_PRIORITY, NULL, 0);
+#endif
+}
 
 ////////////　ボ ー レ ー ト  の 表 示 用 変 換　////////////
 int BaudRateDisp(unsigned char dat)
@@ -241,8 +269,7 @@ void RS30x_NewID(unsigned char dat)
     SendPacket(RS30x_s_data, 9); // パケットデータ送信
 
     delay(1000);
-    Serial.print("New Servo ID is ");
-    Serial.println(dat);
+    LOG_INFO_VAL_LN("New Servo ID is ", dat);
     delay(10);
 }
 
@@ -271,9 +298,8 @@ void RS30x_SetReplayDelay(unsigned char dat)
 
     SendPacket(RS30x_s_data, 9); // パケットデータ送信
 
-    Serial.print("Response Delay Time set to ");
-    Serial.print(short(dat) * 50 + 100);
-    Serial.println(" μs.");
+    LOG_INFO_VAL("Response Delay Time set to ", short(dat) * 50 + 100);
+    LOG_INFO_LN(" μs.");
     delay(500);
 }
 
@@ -304,11 +330,11 @@ void RS30x_Reverse(unsigned char dat)
 
     if (dat == 0)
     {
-        Serial.println("Rotatin changed to FORWARD, CW.");
+        LOG_INFO_LN("Rotatin changed to FORWARD, CW.");
     }
     else if (dat == 1)
     {
-        Serial.println("Rotatin changed to REWARD, CCW.");
+        LOG_INFO_LN("Rotatin changed to REWARD, CCW.");
     }
     delay(500);
 }
@@ -411,8 +437,7 @@ void RS30x_SetSerialSpeedAll()
     RS30x_s_data[6] = 0x01;             // Count
     RS30x_s_data[7] = TARGET_BAUD_RATE; // dat
 
-    Serial.print("MADI Write RS30x servo's BAUDRATE to ");
-    Serial.println(FutabaBaudRates[int(TARGET_BAUD_RATE)]);
+    LOG_INFO_VAL_LN("MADI Write RS30x servo's BAUDRATE to ", FutabaBaudRates[int(TARGET_BAUD_RATE)]);
 
     // チェックサム計算
     for (int i = 2; i < 8; i++)
@@ -421,7 +446,7 @@ void RS30x_SetSerialSpeedAll()
     }
     RS30x_s_data[8] = RS30x_s_cksum; // Sum
 
-    Serial.print("Processing...");
+    LOG_INFO("Processing...");
 
     for (int i = 0; i < 12; i++)
     {
@@ -434,19 +459,19 @@ void RS30x_SetSerialSpeedAll()
 
         Write_and_Reboot();
 
-        Serial.print(11 - i);
+        LOG_INFO_VAL("", 11 - i);
         if (i < 11)
         {
-            Serial.print(",");
+            LOG_INFO(",");
         }
         else
         {
-            Serial.print(".");
+            LOG_INFO(".");
         }
         delay(100);
         Serial2.end();
     }
-    Serial.println();
+    LOG_INFO_LN("");
 }
 
 // ■ サ ー ボ 角 度 の 読 み 込 み _R -------------------------------
@@ -579,32 +604,66 @@ void RS30x_Read_Data(unsigned char id, unsigned char add, unsigned char len)
             // Serial.print(" ");
         }
     }
-    Serial.print("         ID : ");
-    Serial.println(IDdatraw[5]);
-    Serial.print("   Rotation : ");
+    LOG_INFO_VAL_LN("         ID : ", IDdatraw[5]);
+    LOG_INFO("   Rotation : ");
     if (IDdatraw[6] == 0)
     {
-        Serial.println("Foward, CW");
+        LOG_INFO_LN("Foward, CW");
     }
     else
     {
-        Serial.println("Reward, CCW");
+        LOG_INFO_LN("Reward, CCW");
     }
-    Serial.print("      Speed : ");
-    Serial.print(BaudRateDisp(IDdatraw[7]));
-    Serial.println(" bps");
+    LOG_INFO_VAL("      Speed : ", BaudRateDisp(IDdatraw[7]));
+    LOG_INFO_LN(" bps");
 
-    Serial.print("ReturnDelay : ");
-    Serial.print(short(IDdatraw[8]) * 50 + 100);
-    Serial.println(" μs");
+    LOG_INFO_VAL("ReturnDelay : ", short(IDdatraw[8]) * 50 + 100);
+    LOG_INFO_LN(" μs");
+}
+
+///////////////　ブ リ ッ ジ モ ー ド の 開 始　///////////////
+// 中継処理の本体はRS30x_Bridge.hにあります.
+#define BRIDGE_HOST_BAUD 921600 // ブリッジモードでのPCとの通信速度
+#define BRIDGE_RX_BUF_SIZE 1024 // PCからの要求を溜めておく受信バッファのサイズ
+#define BRIDGE_TX_BUF_SIZE 1024 // PCへの返信を溜めておく送信バッファのサイズ
+
+BridgePort Bridge; // PC(Serial)とサーボ(Serial2)をつなぐブリッジ
+
+void Bridge_Begin()
+{
+    unsigned long baud = FutabaBaudRates[int(TARGET_BAUD_RATE)];
+
+    Bridge.host = &Serial;
+    Bridge.bus = &Serial2;
+    Bridge.now = micros;
+    Bridge.send = SendPacket;
+    // サーボの返信ディレイはPC側のツールから書き換えられることもあるため, 常に最大値(127)で見積もる
+    Bridge_SetTiming(Bridge, baud, BRIDGE_HOST_BAUD, 127);
+
+    // 1回の中継でPCとは要求12byte+返信21byte程度をやりとりするため, 通常時の速度では
+    // それだけで1ms以上かかる. サーボ側の691200bpsより速い速度でPCとつなぎ,
+    // 続けて届いた要求の返信も送信バッファに積むだけで済むようにする.
+    Serial.setRxBufferSize(BRIDGE_RX_BUF_SIZE); // 複数の要求を溜めておけるよう受信バッファを拡大
+    Serial.setTxBufferSize(BRIDGE_TX_BUF_SIZE); // 返信の書き込みで待たされないよう送信バッファを確保
+    Serial.begin(BRIDGE_HOST_BAUD);
+
+    Serial2.begin(baud); // サーボとの通信を開始
 }
 
 void setup()
 {
     pinMode(EN_R_PIN, OUTPUT); // デジタルPin2(EN_R_PIN)を出力に設定
+
+    if (USE_BRIDGE == 1) // ブリッジモードではログを出さずにパケットの中継のみを行う
+    {
+        Bridge_Begin();
+        return;
+    }
+
     Serial.begin(200000);      // Teensy4.0とPCとのシリアル通信速度
+    Log_Begin();               // ログ送信タスクの開始
     delay(150);
-    Serial.println();
+    LOG_INFO_LN("");
 
     if (USE_MADIWRITE) // マディライトをするかどうか
     {
@@ -612,18 +671,17 @@ void setup()
     }
     Serial2.begin(FutabaBaudRates[int(TARGET_BAUD_RATE)]); // 現在のシリアルサーボのボーレート（デフォルトは115,200bps）
 
-    Serial.print("Now Serial begin in "); // 現在の通信速度のボーレートを表示
-    Serial.print(BaudRateDisp(TARGET_BAUD_RATE));
-    Serial.println(" bps.");
+    LOG_INFO_VAL("Now Serial begin in ", BaudRateDisp(TARGET_BAUD_RATE)); // 現在の通信速度のボーレートを表示
+    LOG_INFO_LN(" bps.");
 
     if (AllReset == 1) // ファクトリーリセットをするか
     {
         delay(1000);
-        Serial.print("Execute");
+        LOG_INFO("Execute");
         delay(1000);
-        Serial.print(" Factory");
+        LOG_INFO(" Factory");
         delay(1000);
-        Serial.println(" Reset.");
+        LOG_INFO_LN(" Reset.");
         delay(1000);
 
         FactoryReset();
@@ -633,9 +691,8 @@ void setup()
         delay(100);
         TARGET_BAUD_RATE = 0x07;
         Serial2.begin(FutabaBaudRates[int(TARGET_BAUD_RATE)]); // 現在のシリアルサーボのボーレート（デフォルトは115,200bps）
-        Serial.print("Now Serial restarted in ");              // 現在の通信速度のボーレートを表示
-        Serial.print(BaudRateDisp(TARGET_BAUD_RATE));
-        Serial.println(" bps.");
+        LOG_INFO_VAL("Now Serial restarted in ", BaudRateDisp(TARGET_BAUD_RATE)); // 現在の通信速度のボーレートを表示
+        LOG_INFO_LN(" bps.");
     }
 
     if (NewID != 0) // IDを書き込むかどうか
@@ -656,8 +713,8 @@ void setup()
         Write_and_Reboot();
     }
 
-    Serial.println();
-    Serial.println("Servo Information from RS30x..."); // サーボから受信するデータの表示
+    LOG_INFO_LN("");
+    LOG_INFO_LN("Servo Information from RS30x..."); // サーボから受信するデータの表示
 
     // 全サーボトルクオン
     RS30x_Torque(255, 0x01); // ID = 1(0x01) , RS30x_Torque = ON   (0x01)
@@ -671,17 +728,23 @@ void setup()
 
 void loop()
 {
+    if (USE_BRIDGE == 1) // ブリッジモード
+    {
+        Bridge_Poll(Bridge);
+        return;
+    }
+
     RS30x_Move(255, 0, RS30x_speed); // ID=255は全サーボ , GoalPosition = 0deg(100) , Time = 1.0sec(RS30x_speed=100)
-    Serial.print("+,");
+    LOG_DEBUG("+,");
     delay(1000);
-    Serial.print("0,");
+    LOG_DEBUG("0,");
     delay(1000);
-    Serial.print("0,");
+    LOG_DEBUG("0,");
     delay(1000);
     RS30x_Move(255, 600, RS30x_speed); // ID=255は全サーボ , GoalPosition = 10.0deg(100) , Time = 1.0sec(RS30x_speed=100)
-    Serial.print("+,");
+    LOG_DEBUG("+,");
     delay(1000);
     RS30x_Move(255, -600, RS30x_speed); // ID=255は全サーボ , GoalPosition = -10.0deg(-100) , Time = 1.0sec(RS30x_speed=100)
-    Serial.print("-,");
+    LOG_DEBUG("-,");
     delay(1000);
 }
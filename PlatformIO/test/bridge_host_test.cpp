@@ -0,0 +1,598 @@
+// RS30x ブリッジモードのPC上テスト (Linux)
+// ビルドと実行 (PlatformIOディレクトリで):
+//   g++ -std=c++11 -Wall -pthread -I test/host -I src test/bridge_host_test.cpp -lutil -o bridge_host_test && ./bridge_host_test
+// 前半はメモリ上のストリームと, 呼ばれるたびに1μs進む時計で動かします.
+// 後半(TestPty～)はPC側, サーボ側ともptyにつなぎ, 実際の時計と模擬サーボ(SimServo)で動かします.
+
+#include <cstdio>
+#include <deque>
+#include <time.h>
+#include <vector>
+
+#include "FdStream.h"
+#include "RS30x_Bridge.h"
+#include "SimServo.h"
+
+class MemStream : public Stream
+{
+public:
+    std::deque<uint8_t> in;   // 読み出される側のデータ
+    std::vector<uint8_t> out; // 書き込まれたデータ
+
+    int available() { return (int)in.size(); }
+    int read()
+    {
+        if (in.empty())
+        {
+            return -1;
+        }
+        int c = in.front();
+        in.pop_front();
+        return c;
+    }
+    int peek() { return in.empty() ? -1 : in.front(); }
+    size_t write(const uint8_t *buffer, size_t size)
+    {
+        out.insert(out.end(), buffer, buffer + size);
+        return size;
+    }
+};
+
+MemStream Host;                     // PC側
+MemStream Bus;                      // サーボ側
+std::vector<uint8_t> BusReply;      // 次にサーボへ送った時に返すデータ
+std::vector<uint8_t> BusSent;       // サーボへ送ったパケット
+bool BusEcho = false;               // 送信したパケットが受信側に返ってくる構成
+unsigned long FakeUs = 0;           // テスト用の時計
+
+unsigned long FakeNow() { return ++FakeUs; }
+
+void FakeSend(unsigned char *data, int len)
+{
+    BusSent.assign(data, data + len);
+    if (BusEcho)
+    {
+        Bus.in.insert(Bus.in.end(), data, data + len);
+    }
+    Bus.in.insert(Bus.in.end(), BusReply.begin(), BusReply.end());
+}
+
+int Failures = 0;
+
+#define CHECK(cond)                                                  \
+    do                                                               \
+    {                                                                \
+        if (!(cond))                                                 \
+        {                                                            \
+            printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            Failures++;                                              \
+        }                                                            \
+    } while (0)
+
+void Setup(BridgePort &b)
+{
+    Host.in.clear();
+    Host.out.clear();
+    Bus.in.clear();
+    Bus.out.clear();
+    BusReply.clear();
+    BusSent.clear();
+    BusEcho = false;
+    b.host = &Host;
+    b.bus = &Bus;
+    b.now = FakeNow;
+    b.send = FakeSend;
+    Bridge_SetTiming(b, 691200, 921600, 127);
+}
+
+// PCからのフレームを作る
+void HostFrame(unsigned char seq, const std::vector<uint8_t> &packet)
+{
+    unsigned char sum = seq ^ (unsigned char)packet.size();
+    Host.in.push_back(BRIDGE_SYNC);
+    Host.in.push_back(seq);
+    Host.in.push_back((unsigned char)packet.size());
+    for (size_t i = 0; i < packet.size(); i++)
+    {
+        Host.in.push_back(packet[i]);
+        sum ^= packet[i];
+    }
+    Host.in.push_back(sum);
+}
+
+// PCへの返信フレームを1つ取り出す. 形が崩れていればfalse.
+bool ParseReply(const std::vector<uint8_t> &o, size_t &pos, unsigned char &seq, unsigned char &status, unsigned long &t_reply, std::vector<uint8_t> &data)
+{
+    if (pos + 13 > o.size() || o[pos] != BRIDGE_SYNC)
+    {
+        return false;
+    }
+    int len = o[pos + 11];
+    if (pos + 13 + len > o.size())
+    {
+        return false;
+    }
+    unsigned char sum = 0;
+    for (int i = 1; i < 12 + len; i++)
+    {
+        sum ^= o[pos + i];
+    }
+    if (sum != o[pos + 12 + len])
+    {
+        return false;
+    }
+    seq = o[pos + 1];
+    status = o[pos + 2];
+    t_reply = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        t_reply |= (unsigned long)o[pos + 7 + i] << (8 * i);
+    }
+    data.assign(o.begin() + pos + 12, o.begin() + pos + 12 + len);
+    pos += 13 + len;
+    return true;
+}
+
+bool HostReply(size_t &pos, unsigned char &seq, unsigned char &status, unsigned long &t_reply, std::vector<uint8_t> &data)
+{
+    return ParseReply(Host.out, pos, seq, status, t_reply, data);
+}
+
+const std::vector<uint8_t> ReadAngle = {0xFA, 0xAF, 0x01, 0x0F, 0x2A, 0x02, 0x00, 0x26};
+const std::vector<uint8_t> TorqueOn = {0xFA, 0xAF, 0x01, 0x00, 0x24, 0x01, 0x01, 0x01, 0x24};
+
+void TestFeed()
+{
+    BridgeParser p;
+    p.state = 0;
+    const unsigned char ok[] = {0x55, BRIDGE_SYNC, 0x03, 0x02, 0x10, 0x20, 0x03 ^ 0x02 ^ 0x10 ^ 0x20};
+    int result = BRIDGE_FEED_NONE;
+    for (size_t i = 0; i < sizeof(ok); i++)
+    {
+        result = Bridge_Feed(p, ok[i]);
+        if (i + 1 < sizeof(ok))
+        {
+            CHECK(result == BRIDGE_FEED_NONE);
+        }
+    }
+    CHECK(result == BRIDGE_FEED_FRAME);
+    CHECK(p.seq == 0x03 && p.len == 2 && p.data[0] == 0x10 && p.data[1] == 0x20);
+
+    const unsigned char bad_sum[] = {BRIDGE_SYNC, 0x04, 0x01, 0x10, 0x00};
+    for (size_t i = 0; i < sizeof(bad_sum); i++)
+    {
+        result = Bridge_Feed(p, bad_sum[i]);
+    }
+    CHECK(result == BRIDGE_FEED_ERROR);
+    CHECK(p.state == 0);
+
+    Bridge_Feed(p, BRIDGE_SYNC);
+    Bridge_Feed(p, 0x05);
+    CHECK(Bridge_Feed(p, 0) == BRIDGE_FEED_ERROR); // Len 0
+    CHECK(p.state == 0);
+}
+
+void TestReadReply()
+{
+    BridgePort b;
+    Setup(b);
+    // 先頭のゴミを読み飛ばしてHeaderに同期できること
+    BusReply = {0x55, 0xFD, 0xFD, 0xDF, 0x01, 0x00, 0x2A, 0x02, 0x01, 0x34, 0x12, 0x00};
+    unsigned char sum = 0;
+    for (int i = 4; i < 11; i++)
+    {
+        sum ^= BusReply[i];
+    }
+    BusReply[11] = sum;
+
+    HostFrame(7, ReadAngle);
+    Bridge_Poll(b);
+
+    CHECK(BusSent == ReadAngle);
+    size_t pos = 0;
+    unsigned char seq, status;
+    unsigned long t_reply;
+    std::vector<uint8_t> data;
+    CHECK(HostReply(pos, seq, status, t_reply, data));
+    CHECK(seq == 7 && status == BRIDGE_STATUS_OK);
+    CHECK(data == std::vector<uint8_t>(BusReply.begin() + 2, BusReply.end()));
+    CHECK(pos == Host.out.size());
+}
+
+void TestPipelined()
+{
+    BridgePort b;
+    Setup(b);
+    HostFrame(1, TorqueOn);
+    HostFrame(2, TorqueOn);
+    HostFrame(3, {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07}); // RS30xのパケットではない
+    Bridge_Poll(b);
+
+    size_t pos = 0;
+    unsigned char seq, status;
+    unsigned long t_reply;
+    std::vector<uint8_t> data;
+    CHECK(HostReply(pos, seq, status, t_reply, data));
+    CHECK(seq == 1 && status == BRIDGE_STATUS_NO_REPLY);
+    CHECK(HostReply(pos, seq, status, t_reply, data));
+    CHECK(seq == 2 && status == BRIDGE_STATUS_NO_REPLY);
+    CHECK(HostReply(pos, seq, status, t_reply, data));
+    CHECK(seq == 3 && status == BRIDGE_STATUS_BAD_FRAME);
+    CHECK(pos == Host.out.size());
+}
+
+void TestReplyTimeout()
+{
+    BridgePort b;
+    Setup(b);
+    HostFrame(9, ReadAngle); // サーボは何も返さない
+    Bridge_Poll(b);
+
+    size_t pos = 0;
+    unsigned char seq, status;
+    unsigned long t_reply;
+    std::vector<uint8_t> data;
+    CHECK(HostReply(pos, seq, status, t_reply, data));
+    CHECK(seq == 9 && status == BRIDGE_STATUS_TIMEOUT);
+    CHECK(data.empty());
+    CHECK(t_reply > b.first_byte_us);               // 返信ディレイ分は待つ
+    CHECK(t_reply <= b.first_byte_us + b.gap_us);   // それ以上は待たない
+
+    // 返信が途中で途切れた場合もバイト間の待ち時間でタイムアウトすること
+    Setup(b);
+    BusReply = {0xFD, 0xDF, 0x01, 0x00, 0x2A};
+    HostFrame(10, ReadAngle);
+    Bridge_Poll(b);
+    pos = 0;
+    CHECK(HostReply(pos, seq, status, t_reply, data));
+    CHECK(seq == 10 && status == BRIDGE_STATUS_TIMEOUT);
+    CHECK(t_reply < b.first_byte_us);
+}
+
+void TestAck()
+{
+    const std::vector<uint8_t> TorqueOnAck = {0xFA, 0xAF, 0x01, 0x01, 0x24, 0x01, 0x01, 0x01, 0x25};
+    BridgePort b;
+    Setup(b);
+    // ACK/NACK以外のバイトは読み飛ばすこと
+    BusReply = {0x55, 0xFA, RS30X_NACK};
+    HostFrame(11, TorqueOnAck);
+    Bridge_Poll(b);
+
+    size_t pos = 0;
+    unsigned char seq, status;
+    unsigned long t_reply;
+    std::vector<uint8_t> data;
+    CHECK(HostReply(pos, seq, status, t_reply, data));
+    CHECK(seq == 11 && status == BRIDGE_STATUS_OK);
+    CHECK(data == std::vector<uint8_t>(1, RS30X_NACK));
+
+    // ノイズだけならタイムアウトになること
+    Setup(b);
+    BusReply = {0x55};
+    HostFrame(12, TorqueOnAck);
+    Bridge_Poll(b);
+    pos = 0;
+    CHECK(HostReply(pos, seq, status, t_reply, data));
+    CHECK(seq == 12 && status == BRIDGE_STATUS_TIMEOUT);
+}
+
+void TestAckEcho()
+{
+    // ID 7 へのACK要求. エコーの中の0x07をACKと取り違えないこと
+    const std::vector<uint8_t> TorqueOnAck7 = {0xFA, 0xAF, 0x07, 0x01, 0x24, 0x01, 0x01, 0x01, 0x23};
+    BridgePort b;
+    Setup(b);
+    BusEcho = true;
+    BusReply = {RS30X_NACK};
+    HostFrame(13, TorqueOnAck7);
+    Bridge_Poll(b);
+
+    size_t pos = 0;
+    unsigned char seq, status;
+    unsigned long t_reply;
+    std::vector<uint8_t> data;
+    CHECK(HostReply(pos, seq, status, t_reply, data));
+    CHECK(seq == 13 && status == BRIDGE_STATUS_OK);
+    CHECK(data == std::vector<uint8_t>(1, RS30X_NACK));
+    CHECK(Bus.in.empty());
+
+    // エコーだけで返信がなければタイムアウトになること
+    Setup(b);
+    BusEcho = true;
+    HostFrame(14, TorqueOnAck7);
+    Bridge_Poll(b);
+    pos = 0;
+    CHECK(HostReply(pos, seq, status, t_reply, data));
+    CHECK(seq == 14 && status == BRIDGE_STATUS_TIMEOUT);
+}
+
+void TestHostGap()
+{
+    BridgePort b;
+    Setup(b);
+    // 1byte欠けたフレーム (Len 9 に対してデータが8byte)
+    Host.in.push_back(BRIDGE_SYNC);
+    Host.in.push_back(5);
+    Host.in.push_back((unsigned char)TorqueOn.size());
+    Host.in.insert(Host.in.end(), TorqueOn.begin(), TorqueOn.end() - 1);
+    Bridge_Poll(b);
+    CHECK(Host.out.empty());
+
+    // 無通信時間が続いた後の次の要求は, 欠けたフレームの続きとして扱わないこと
+    FakeUs += b.host_gap_us + 1;
+    HostFrame(6, TorqueOn);
+    Bridge_Poll(b);
+
+    size_t pos = 0;
+    unsigned char seq, status;
+    unsigned long t_reply;
+    std::vector<uint8_t> data;
+    CHECK(HostReply(pos, seq, status, t_reply, data));
+    CHECK(seq == 5 && status == BRIDGE_STATUS_BAD_FRAME);
+    CHECK(HostReply(pos, seq, status, t_reply, data));
+    CHECK(seq == 6 && status == BRIDGE_STATUS_NO_REPLY);
+    CHECK(BusSent == TorqueOn);
+    CHECK(pos == Host.out.size());
+}
+
+void TestPipelinedLostByte()
+{
+    BridgePort b;
+    Setup(b);
+    // 1byte欠けたフレームの直後に, 間を空けずに次のフレームが届く場合
+    Host.in.push_back(BRIDGE_SYNC);
+    Host.in.push_back(5);
+    Host.in.push_back((unsigned char)TorqueOn.size());
+    Host.in.insert(Host.in.end(), TorqueOn.begin(), TorqueOn.end() - 1);
+    HostFrame(6, TorqueOn);
+    HostFrame(7, TorqueOn);
+    Bridge_Poll(b);
+
+    size_t pos = 0;
+    unsigned char seq, status;
+    unsigned long t_reply;
+    std::vector<uint8_t> data;
+    CHECK(HostReply(pos, seq, status, t_reply, data));
+    CHECK(seq == 5 && status == BRIDGE_STATUS_BAD_FRAME);
+    CHECK(HostReply(pos, seq, status, t_reply, data));
+    CHECK(seq == 6 && status == BRIDGE_STATUS_NO_REPLY);
+    CHECK(HostReply(pos, seq, status, t_reply, data));
+    CHECK(seq == 7 && status == BRIDGE_STATUS_NO_REPLY);
+    CHECK(pos == Host.out.size());
+}
+
+////////////////////////////////　ptyでのテスト　////////////////////////////////
+
+struct PtyBench
+{
+    int host_master, host_slave; // PC側 (テストがmaster, ブリッジがslave)
+    int bus_master, bus_slave;   // サーボ側 (SimServoがmaster, ブリッジがslave)
+};
+
+PtyBench Pty;
+bool PtyEcho = false; // 送信したパケットが受信側に返ってくる構成 (Meridian Board -LITE- など)
+
+unsigned long RealNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+void PtySend(unsigned char *data, int len)
+{
+    ssize_t n = write(Pty.bus_slave, data, len); // サーボへ
+    if (PtyEcho)
+    {
+        n = write(Pty.bus_master, data, len); // 自分の受信側へのエコー
+    }
+    (void)n;
+}
+
+// RS30xのショートパケットを作る
+std::vector<uint8_t> MakePacket(unsigned char id, unsigned char flags, unsigned char addr, unsigned char len, unsigned char cnt, const std::vector<uint8_t> &dat)
+{
+    std::vector<uint8_t> p = {0xFA, 0xAF, id, flags, addr, len, cnt};
+    p.insert(p.end(), dat.begin(), dat.end());
+    unsigned char sum = 0;
+    for (size_t i = 2; i < p.size(); i++)
+    {
+        sum ^= p[i];
+    }
+    p.push_back(sum);
+    return p;
+}
+
+void PtyFrame(unsigned char seq, const std::vector<uint8_t> &packet)
+{
+    std::vector<uint8_t> f = {BRIDGE_SYNC, seq, (unsigned char)packet.size()};
+    unsigned char sum = seq ^ (unsigned char)packet.size();
+    for (size_t i = 0; i < packet.size(); i++)
+    {
+        f.push_back(packet[i]);
+        sum ^= packet[i];
+    }
+    f.push_back(sum);
+    ssize_t n = write(Pty.host_master, f.data(), f.size());
+    (void)n;
+}
+
+// 返信フレームが want 個揃うか timeout_us が過ぎるまでブリッジを動かし, PC側で受け取ったデータを返す
+std::vector<uint8_t> PtyRun(BridgePort &b, int want, unsigned long timeout_us)
+{
+    std::vector<uint8_t> out;
+    unsigned long start = RealNow();
+    int got = 0;
+    while (got < want && RealNow() - start < timeout_us)
+    {
+        Bridge_Poll(b);
+        unsigned char c;
+        while (read(Pty.host_master, &c, 1) == 1)
+        {
+            out.push_back(c);
+        }
+        size_t pos = 0;
+        unsigned char seq, status;
+        unsigned long t_reply;
+        std::vector<uint8_t> data;
+        got = 0;
+        while (ParseReply(out, pos, seq, status, t_reply, data))
+        {
+            got++;
+        }
+    }
+    return out;
+}
+
+bool PtySetup(BridgePort &b)
+{
+    if (!OpenRawPty(Pty.host_master, Pty.host_slave) || !OpenRawPty(Pty.bus_master, Pty.bus_slave))
+    {
+        printf("openpty failed.\n");
+        return false;
+    }
+    PtyEcho = false;
+    b.host = new FdStream(Pty.host_slave);
+    b.bus = new FdStream(Pty.bus_slave);
+    b.now = RealNow;
+    b.send = PtySend;
+    Bridge_SetTiming(b, 691200, 921600, 127);
+    return true;
+}
+
+void PtyTeardown(BridgePort &b)
+{
+    delete b.host;
+    delete b.bus;
+    close(Pty.host_master);
+    close(Pty.host_slave);
+    close(Pty.bus_master);
+    close(Pty.bus_slave);
+}
+
+void TestPtyRead()
+{
+    BridgePort b;
+    if (!PtySetup(b))
+    {
+        Failures++;
+        return;
+    }
+    PtyEcho = true;
+    SimServo servo(Pty.bus_master, 1);
+    servo.mem[0x2A] = 0x34;
+    servo.mem[0x2B] = 0x12;
+    servo.reply_delay_us = 300;
+    servo.Start();
+
+    PtyFrame(20, MakePacket(1, 0x0F, 0x2A, 0x02, 0x00, {}));
+    std::vector<uint8_t> out = PtyRun(b, 1, 1000000);
+    servo.Stop();
+
+    size_t pos = 0;
+    unsigned char seq, status;
+    unsigned long t_reply;
+    std::vector<uint8_t> data;
+    CHECK(ParseReply(out, pos, seq, status, t_reply, data));
+    CHECK(seq == 20 && status == BRIDGE_STATUS_OK);
+    CHECK(data.size() == 10 && data[0] == 0xFD && data[2] == 1 && data[7] == 0x34 && data[8] == 0x12);
+    CHECK(t_reply >= servo.reply_delay_us); // 返信ディレイより早くは返らない
+    CHECK(t_reply < b.first_byte_us);
+    PtyTeardown(b);
+}
+
+void TestPtyPipelined()
+{
+    BridgePort b;
+    if (!PtySetup(b))
+    {
+        Failures++;
+        return;
+    }
+    PtyEcho = true;
+    SimServo servo(Pty.bus_master, 8); // エコーにIDの0x08(NACKと同じ値)が含まれる
+    servo.Start();
+
+    PtyFrame(21, MakePacket(8, 0x01, 0x24, 0x01, 0x01, {0x01})); // トルクオン, ACK要求
+    PtyFrame(22, MakePacket(8, 0x0F, 0x24, 0x01, 0x00, {}));     // トルク設定の読み出し
+    PtyFrame(23, MakePacket(8, 0x00, 0x24, 0x01, 0x01, {0x00})); // トルクオフ, 返信なし
+    std::vector<uint8_t> out = PtyRun(b, 3, 1000000);
+    servo.Stop();
+
+    size_t pos = 0;
+    unsigned char seq, status;
+    unsigned long t_reply;
+    std::vector<uint8_t> data;
+    CHECK(ParseReply(out, pos, seq, status, t_reply, data));
+    CHECK(seq == 21 && status == BRIDGE_STATUS_OK);
+    CHECK(data == std::vector<uint8_t>(1, RS30X_ACK));
+    CHECK(t_reply >= servo.reply_delay_us);
+    CHECK(ParseReply(out, pos, seq, status, t_reply, data));
+    CHECK(seq == 22 && status == BRIDGE_STATUS_OK);
+    CHECK(data.size() == 9 && data[7] == 0x01);
+    CHECK(ParseReply(out, pos, seq, status, t_reply, data));
+    CHECK(seq == 23 && status == BRIDGE_STATUS_NO_REPLY);
+    CHECK(pos == out.size());
+    CHECK(servo.packets == 3);
+    CHECK(servo.mem[0x24] == 0x00);
+    PtyTeardown(b);
+}
+
+void TestPtyTimeout()
+{
+    BridgePort b;
+    if (!PtySetup(b))
+    {
+        Failures++;
+        return;
+    }
+    PtyEcho = true;
+    SimServo servo(Pty.bus_master, 1);
+    servo.Start();
+
+    PtyFrame(24, MakePacket(2, 0x0F, 0x2A, 0x02, 0x00, {})); // 接続されていないID
+    std::vector<uint8_t> out = PtyRun(b, 1, 1000000);
+
+    size_t pos = 0;
+    unsigned char seq, status;
+    unsigned long t_reply;
+    std::vector<uint8_t> data;
+    CHECK(ParseReply(out, pos, seq, status, t_reply, data));
+    CHECK(seq == 24 && status == BRIDGE_STATUS_TIMEOUT);
+    CHECK(t_reply > b.first_byte_us);
+    CHECK(t_reply < b.first_byte_us + b.gap_us + 20000); // スケジューリングの遅れを見込む
+
+    // 返信ディレイが待ち時間より長いサーボもタイムアウトになること
+    servo.reply_delay_us = b.first_byte_us + 5000;
+    PtyFrame(25, MakePacket(1, 0x0F, 0x2A, 0x02, 0x00, {}));
+    out = PtyRun(b, 1, 1000000);
+    servo.Stop();
+    pos = 0;
+    CHECK(ParseReply(out, pos, seq, status, t_reply, data));
+    CHECK(seq == 25 && status == BRIDGE_STATUS_TIMEOUT);
+    PtyTeardown(b);
+}
+
+int main()
+{
+    TestFeed();
+    TestReadReply();
+    TestPipelined();
+    TestReplyTimeout();
+    TestAck();
+    TestAckEcho();
+    TestHostGap();
+    TestPipelinedLostByte();
+    TestPtyRead();
+    TestPtyPipelined();
+    TestPtyTimeout();
+
+    if (Failures > 0)
+    {
+        printf("%d check(s) failed.\n", Failures);
+        return 1;
+    }
+    printf("All bridge tests passed.\n");
+    return 0;
+}
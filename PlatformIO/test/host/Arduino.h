@@ -0,0 +1,21 @@
+// PC上でブリッジとログのテストをビルドするための最小限のArduino.h
+// RS30x_Bridge.h, RS30x_Log.h が使うStreamだけを用意しています.
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <cstddef>
+#include <cstdint>
+
+class Stream
+{
+public:
+    virtual ~Stream() {}
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+    virtual int availableForWrite() { return 0; }
+};
+
+#endif
@@ -0,0 +1,83 @@
+// ファイルディスクリプタ (ptyなど) を読み書きするStream
+// PC上のテストで, ブリッジのPC側やサーボ側をptyにつなぐために使います.
+
+#ifndef HOST_FD_STREAM_H
+#define HOST_FD_STREAM_H
+
+#include <Arduino.h>
+
+#include <fcntl.h>
+#include <pty.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+class FdStream : public Stream
+{
+public:
+    explicit FdStream(int fd) : fd_(fd), peeked_(-1) {}
+
+    int available()
+    {
+        int n = 0;
+        if (ioctl(fd_, FIONREAD, &n) < 0)
+        {
+            n = 0;
+        }
+        return n + (peeked_ >= 0 ? 1 : 0);
+    }
+    int read()
+    {
+        if (peeked_ >= 0)
+        {
+            int c = peeked_;
+            peeked_ = -1;
+            return c;
+        }
+        unsigned char c;
+        return (::read(fd_, &c, 1) == 1) ? c : -1;
+    }
+    int peek()
+    {
+        if (peeked_ < 0)
+        {
+            peeked_ = read();
+        }
+        return peeked_;
+    }
+    size_t write(const uint8_t *buffer, size_t size)
+    {
+        size_t done = 0;
+        while (done < size)
+        {
+            ssize_t n = ::write(fd_, buffer + done, size - done);
+            if (n > 0)
+            {
+                done += n;
+            }
+        }
+        return size;
+    }
+
+private:
+    int fd_;     // 読み書きするファイルディスクリプタ
+    int peeked_; // peek()で先読みしたバイト (なければ-1)
+};
+
+// バイナリをそのまま通すrawモードのptyを開く. 両端ともノンブロッキング.
+inline bool OpenRawPty(int &master, int &slave)
+{
+    if (openpty(&master, &slave, NULL, NULL, NULL) < 0)
+    {
+        return false;
+    }
+    struct termios tio;
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    fcntl(slave, F_SETFL, fcntl(slave, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+#endif
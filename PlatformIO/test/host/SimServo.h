@@ -0,0 +1,143 @@
+// PC上のテスト用のRS30xサーボの模擬
+// ptyのmaster側で受け取ったパケットのID, Flagsに応じて, 返信ディレイの後にACK/NACKまたはリターンパケットを返します.
+// リターンパケットはFlags 0x0F (アドレス指定) のみ対応しています.
+
+#ifndef HOST_SIM_SERVO_H
+#define HOST_SIM_SERVO_H
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+
+class SimServo
+{
+public:
+    unsigned char id;            // サーボID
+    unsigned char mem[128];      // メモリマップ
+    unsigned long reply_delay_us; // 返信ディレイ [μs]
+    std::atomic<int> packets;    // 受け取ったパケット数
+
+    SimServo(int fd, unsigned char servo_id)
+        : id(servo_id), reply_delay_us(100), packets(0), fd_(fd), stop_(false), n_(0)
+    {
+        memset(mem, 0, sizeof(mem));
+        mem[4] = servo_id;
+    }
+    ~SimServo() { Stop(); }
+
+    void Start() { thread_ = std::thread(&SimServo::Run, this); }
+    void Stop()
+    {
+        stop_ = true;
+        if (thread_.joinable())
+        {
+            thread_.join();
+        }
+    }
+
+private:
+    int fd_;                   // ptyのmaster側
+    std::atomic<bool> stop_;   // スレッド終了要求
+    std::thread thread_;       // 受信スレッド
+    unsigned char buf_[300];   // 受信中のパケット
+    int n_;                    // 受信済みのバイト数
+
+    void Run()
+    {
+        while (!stop_)
+        {
+            struct pollfd pfd = {fd_, POLLIN, 0};
+            if (poll(&pfd, 1, 5) <= 0)
+            {
+                continue;
+            }
+            unsigned char c;
+            while (::read(fd_, &c, 1) == 1)
+            {
+                Feed(c);
+            }
+        }
+    }
+
+    void Feed(unsigned char c)
+    {
+        if ((n_ == 0 && c != 0xFA) || (n_ == 1 && c != 0xAF))
+        {
+            n_ = (c == 0xFA) ? 1 : 0; // Header待ち
+            return;
+        }
+        buf_[n_++] = c;
+        if (n_ < 7)
+        {
+            return;
+        }
+        int total = 8 + buf_[5] * buf_[6]; // Header～Cnt + Length×Count分のデータ + Sum
+        if (n_ < total)
+        {
+            return;
+        }
+        n_ = 0;
+        packets++;
+        Handle(total);
+    }
+
+    void Handle(int total)
+    {
+        unsigned char sum = 0;
+        for (int i = 2; i < total - 1; i++)
+        {
+            sum ^= buf_[i];
+        }
+        unsigned char pid = buf_[2], flags = buf_[3], addr = buf_[4], len = buf_[5], cnt = buf_[6];
+        if (pid != id && pid != 0xFF)
+        {
+            return; // 他のサーボ宛て
+        }
+        if (sum != buf_[total - 1])
+        {
+            if ((flags & 0x0F) == 0x01)
+            {
+                Reply(std::vector<unsigned char>(1, 0x08)); // NACK
+            }
+            return;
+        }
+        if (cnt > 0 && addr + len <= (int)sizeof(mem))
+        {
+            memcpy(mem + addr, buf_ + 7, len); // メモリマップへ書き込み
+        }
+
+        unsigned char ret = flags & 0x0F;
+        if (ret == 0x01)
+        {
+            Reply(std::vector<unsigned char>(1, 0x07)); // ACK
+        }
+        else if (ret == 0x0F)
+        {
+            std::vector<unsigned char> r = {0xFD, 0xDF, id, 0x00, addr, len, 0x01};
+            for (int i = 0; i < len; i++)
+            {
+                r.push_back(mem[(addr + i) & 0x7F]);
+            }
+            unsigned char rsum = 0;
+            for (size_t i = 2; i < r.size(); i++)
+            {
+                rsum ^= r[i];
+            }
+            r.push_back(rsum);
+            Reply(r);
+        }
+    }
+
+    void Reply(const std::vector<unsigned char> &r)
+    {
+        usleep(reply_delay_us);
+        ssize_t n = ::write(fd_, r.data(), r.size());
+        (void)n;
+    }
+};
+
+#endif
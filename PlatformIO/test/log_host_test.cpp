@@ -0,0 +1,167 @@
+// RS30x ログ出力のPC上テスト
+// ビルドと実行 (PlatformIOディレクトリで):
+//   g++ -std=c++11 -Wall -I test/host -I src test/log_host_test.cpp -o log_host_test && ./log_host_test
+
+#include <climits>
+#include <cstdio>
+#include <string>
+
+#include "RS30x_Log.h"
+
+// 送信バッファの空きを指定できる出力先
+class RoomStream : public Stream
+{
+public:
+    std::string out; // 書き込まれた文字列
+    int room;        // 送信バッファの空き
+
+    RoomStream() : room(0) {}
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+    int availableForWrite() { return room; }
+    size_t write(const uint8_t *buffer, size_t size)
+    {
+        out.append((const char *)buffer, size);
+        room -= (int)size;
+        return size;
+    }
+};
+
+int Failures = 0;
+
+#define CHECK(cond)                                                  \
+    do                                                               \
+    {                                                                \
+        if (!(cond))                                                 \
+        {                                                            \
+            printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            Failures++;                                              \
+        }                                                            \
+    } while (0)
+
+void Reset(unsigned int pos)
+{
+    LogHead.store(pos);
+    LogTail.store(pos);
+    LogDropped.store(0);
+}
+
+void TestFormat()
+{
+    Reset(0);
+    RoomStream s;
+    s.room = 1000;
+    LOG_INFO("Processing...");
+    LOG_INFO_VAL("", 11);
+    LOG_INFO(",");
+    LOG_INFO_VAL_LN("New Servo ID is ", 12);
+    LOG_INFO_VAL("ReturnDelay : ", -100);
+    LOG_INFO_LN(" us");
+    LOG_DEBUG("+,");
+    Log_Drain(s);
+    CHECK(s.out == "Processing...11,New Servo ID is 12\r\nReturnDelay : -100 us\r\n+,");
+    CHECK(LogTail.load() == LogHead.load());
+
+    // 長すぎる記録は行バッファに収まるよう切り詰める
+    std::string longstr(LOG_LINE_SIZE * 2, 'x');
+    LOG_INFO_LN(longstr.c_str());
+    s.out.clear();
+    Log_Drain(s);
+    CHECK(s.out == std::string(LOG_LINE_SIZE - 1, 'x'));
+}
+
+void TestDeferred()
+{
+    Reset(0);
+    RoomStream s;
+    LOG_INFO_LN("first");
+    LOG_INFO_LN("second");
+
+    // 空きがなければ何も書かず, 記録も残す
+    s.room = 0;
+    Log_Drain(s);
+    CHECK(s.out.empty());
+    CHECK(LogHead.load() - LogTail.load() == 2);
+
+    // 1件分の空きなら1件だけ書く
+    s.room = 7;
+    Log_Drain(s);
+    CHECK(s.out == "first\r\n");
+    CHECK(LogHead.load() - LogTail.load() == 1);
+
+    s.room = 100;
+    Log_Drain(s);
+    CHECK(s.out == "first\r\nsecond\r\n");
+    CHECK(LogTail.load() == LogHead.load());
+}
+
+void TestDropped()
+{
+    Reset(0);
+    RoomStream s;
+    for (int i = 0; i < LOG_BUF_SIZE + 3; i++)
+    {
+        LOG_INFO_VAL(",", i);
+    }
+    CHECK(LogHead.load() - LogTail.load() == LOG_BUF_SIZE);
+    CHECK(LogDropped.load() == 3);
+
+    // 記録は書けても件数の報告が入らなければ, 件数は次回に持ち越す
+    std::string expect;
+    for (int i = 0; i < LOG_BUF_SIZE; i++)
+    {
+        expect += "," + std::to_string(i);
+    }
+    s.room = (int)expect.size();
+    Log_Drain(s);
+    CHECK(s.out == expect);
+    CHECK(LogDropped.load() == 3);
+
+    s.room = 100;
+    Log_Drain(s);
+    CHECK(s.out == expect + "\r\n[log] 3 records dropped.\r\n");
+    CHECK(LogDropped.load() == 0);
+
+    // 空きができれば再び記録できる
+    LOG_INFO("again");
+    CHECK(LogHead.load() - LogTail.load() == 1);
+}
+
+void TestWrap()
+{
+    // 書き込み位置・読み出し位置の数値が一周してもバッファの順序が保たれること
+    Reset(UINT_MAX - 2);
+    RoomStream s;
+    s.room = 1 << 20;
+    std::string expect;
+    for (int round = 0; round < 3; round++)
+    {
+        for (int i = 0; i < LOG_BUF_SIZE; i++)
+        {
+            LOG_INFO_VAL(",", round * LOG_BUF_SIZE + i);
+            expect += "," + std::to_string(round * LOG_BUF_SIZE + i);
+        }
+        CHECK(LogDropped.load() == 0);
+        Log_Drain(s);
+    }
+    CHECK(s.out == expect);
+    CHECK(LogTail.load() == LogHead.load());
+    CHECK(LogHead.load() < UINT_MAX - 2); // 一周している
+}
+
+int main()
+{
+    TestFormat();
+    TestDeferred();
+    TestDropped();
+    TestWrap();
+
+    if (Failures > 0)
+    {
+        printf("%d check(s) failed.\n", Failures);
+        return 1;
+    }
+    printf("All log tests passed.\n");
+    return 0;
+}